@@ -24,7 +24,9 @@
 
 #include "panda3d_imgui.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <deque>
 
 #include <imgui.h>
 
@@ -39,12 +41,199 @@
 #include <geomNode.h>
 #include <geomTriangles.h>
 #include <graphicsWindow.h>
+#include <asyncTaskManager.h>
+#include <asyncTaskChain.h>
+#include <lightMutex.h>
+#include <lightMutexHolder.h>
+#include <virtualFileSystem.h>
+
+// X11 file drop needs to link libX11 and threads, so it is enabled only with PANDA3D_IMGUI_X11_FILE_DROP.
+#if defined(HAVE_X11) && defined(PANDA3D_IMGUI_X11_FILE_DROP)
+#define PANDA3D_IMGUI_XDND
+#endif
 
 #if defined(__WIN32__) || defined(_WIN32)
 #include <WinUser.h>
 #include <shellapi.h>
+#elif defined(PANDA3D_IMGUI_XDND)
+#include <atomic>
+#include <climits>
+#include <thread>
+
+#include <sys/select.h>
+
+#include <configVariableString.h>
+#include <executionEnvironment.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#endif
+
+namespace {
+
+constexpr const char* DROPFILES_TASK_CHAIN_NAME = "imgui-dropfiles";
+constexpr const char* SETTINGS_TASK_CHAIN_NAME = "imgui-settings";
+
+// the number of files delivered by each DROPFILES_EVENT_NAME event
+constexpr size_t DROPFILES_BATCH_SIZE = 1024;
+
+#if defined(__WIN32__) || defined(_WIN32)
+using OSPath = std::wstring;
+
+Filename to_filename(const OSPath& path)
+{
+    return Filename::from_os_specific_w(path);
+}
+#else
+using OSPath = std::string;
+
+Filename to_filename(const OSPath& path)
+{
+    return Filename::from_os_specific(path);
+}
 #endif
 
+}
+
+// ************************************************************************************************
+
+struct Panda3DImGui::DropFileBatches
+{
+    struct Batch
+    {
+        std::vector<Filename> files;
+        LVecBase2 point;
+    };
+
+    LightMutex lock;
+    std::deque<Batch> batches;
+};
+
+/** Convert and check dropped paths in thread, and then deliver them in batches. */
+class Panda3DImGui::DropFilesTask : public AsyncTask
+{
+public:
+    static void post(std::vector<OSPath>&& paths, const LVecBase2& point, const std::shared_ptr<DropFileBatches>& batches)
+    {
+        PT(AsyncTask) task = new DropFilesTask(std::move(paths), point, batches);
+        task->set_task_chain(DROPFILES_TASK_CHAIN_NAME);
+        AsyncTaskManager::get_global_ptr()->add(task);
+    }
+
+    DropFilesTask(std::vector<OSPath>&& paths, const LVecBase2& point, const std::shared_ptr<DropFileBatches>& batches):
+        AsyncTask("imgui-dropfiles"), paths_(std::move(paths)), point_(point), batches_(batches)
+    {
+    }
+
+protected:
+    DoneStatus do_task() override
+    {
+        std::vector<Filename> files;
+        files.reserve((std::min)(paths_.size(), DROPFILES_BATCH_SIZE));
+
+        for (const auto& path : paths_)
+        {
+            Filename filename = to_filename(path);
+            if (!filename.exists())
+                continue;
+
+            files.push_back(std::move(filename));
+            if (files.size() == DROPFILES_BATCH_SIZE)
+            {
+                push_batch(std::move(files));
+                files.clear();
+                files.reserve(DROPFILES_BATCH_SIZE);
+            }
+        }
+
+        if (!files.empty())
+            push_batch(std::move(files));
+
+        return DS_done;
+    }
+
+private:
+    void push_batch(std::vector<Filename>&& files)
+    {
+        LightMutexHolder holder(batches_->lock);
+        batches_->batches.push_back({ std::move(files), point_ });
+    }
+
+    std::vector<OSPath> paths_;
+    LVecBase2 point_;
+    std::shared_ptr<DropFileBatches> batches_;
+};
+
+// ************************************************************************************************
+
+struct Panda3DImGui::SettingsWriter
+{
+    Filename filename;
+
+    LightMutex lock;
+    std::string pending_data;
+    uint64_t pending_serial = 0;         // serial of pending_data, and 0 means no pending data
+    uint64_t last_serial = 0;
+    bool task_scheduled = false;
+
+    LightMutex write_lock;
+    uint64_t written_serial = 0;
+
+    /** Write the pending settings. Older settings than written one are ignored. */
+    void write(const std::string& data, uint64_t serial)
+    {
+        LightMutexHolder holder(write_lock);
+        if (serial <= written_serial)
+            return;
+
+        written_serial = serial;
+
+        // write to temporary file and replace, so the settings are not truncated by crash while writing.
+        auto vfs = VirtualFileSystem::get_global_ptr();
+        const Filename temp_filename = filename.get_fullpath() + ".tmp";
+        if (vfs->write_file(temp_filename, data, false))
+            vfs->rename_file(temp_filename, filename);
+    }
+};
+
+/** Write settings in thread. Settings requested while writing are coalesced into the next write. */
+class Panda3DImGui::SaveSettingsTask : public AsyncTask
+{
+public:
+    SaveSettingsTask(const std::shared_ptr<SettingsWriter>& writer): AsyncTask("imgui-save-settings"), writer_(writer)
+    {
+    }
+
+protected:
+    DoneStatus do_task() override
+    {
+        while (true)
+        {
+            std::string data;
+            uint64_t serial;
+            {
+                LightMutexHolder holder(writer_->lock);
+                if (writer_->pending_serial == 0)
+                {
+                    writer_->task_scheduled = false;
+                    return DS_done;
+                }
+
+                data.swap(writer_->pending_data);
+                serial = writer_->pending_serial;
+                writer_->pending_serial = 0;
+            }
+
+            writer_->write(data, serial);
+        }
+    }
+
+private:
+    std::shared_ptr<SettingsWriter> writer_;
+};
+
+// ************************************************************************************************
+
 class Panda3DImGui::WindowProc : public GraphicsWindowProc
 {
 public:
@@ -62,24 +251,26 @@ public:
                 HDROP hdrop = (HDROP)wparam;
                 POINT pt;
                 DragQueryPoint(hdrop, &pt);
-                p3d_imgui_.dropped_point_ = LVecBase2(static_cast<PN_stdfloat>(pt.x), static_cast<PN_stdfloat>(pt.y));
 
                 const UINT file_count = DragQueryFileW(hdrop, 0xFFFFFFFF, NULL, 0);
 
-                std::vector<wchar_t> buffer;
-                p3d_imgui_.dropped_files_.clear();
+                // copy only raw paths here, and conversion is done in thread.
+                std::vector<OSPath> paths;
+                paths.reserve(file_count);
                 for (UINT k = 0; k < file_count; ++k)
                 {
-                    UINT buffer_size = DragQueryFileW(hdrop, k, NULL, 0) + 1;       // #char + \0
-                    buffer.resize(buffer_size);
-                    UINT ret = DragQueryFileW(hdrop, k, buffer.data(), buffer_size);
+                    OSPath path(DragQueryFileW(hdrop, k, NULL, 0), L'\0');
+                    UINT ret = DragQueryFileW(hdrop, k, &path[0], static_cast<UINT>(path.size() + 1));     // #char + \0
                     if (ret)
-                    {
-                        p3d_imgui_.dropped_files_.push_back(Filename::from_os_specific_w(std::wstring(buffer.begin(), buffer.end() - 1)));
-                    }
+                        paths.push_back(std::move(path));
                 }
 
-                throw_event(DROPFILES_EVENT_NAME);
+                DragFinish(hdrop);
+
+                DropFilesTask::post(
+                    std::move(paths),
+                    LVecBase2(static_cast<PN_stdfloat>(pt.x), static_cast<PN_stdfloat>(pt.y)),
+                    p3d_imgui_.drop_file_batches_);
 
                 break;
             }
@@ -100,16 +291,440 @@ private:
 
 // ************************************************************************************************
 
-Panda3DImGui::Panda3DImGui(GraphicsWindow* window, NodePath parent): window_(window)
+/**
+ * XDND target for the window of Panda3D.
+ *
+ * Panda3D consumes all events of its window, so XDND messages are redirected by XdndProxy
+ * to the window of this class which runs in own connection and thread.
+ *
+ * The connection is opened to the same display as x11 pipe of Panda3D, and it is used only
+ * in the thread of this class. Xlib is not initialized with XInitThreads here (it should be
+ * called before any Xlib call), so this assumes that Xlib is safe for separate connections
+ * in different threads, which is the case for libX11 1.8 or later (threads are initialized
+ * by default). For older libX11, call XInitThreads at the start of application.
+ */
+class Panda3DImGui::XdndProxy
+{
+#if defined(PANDA3D_IMGUI_XDND)
+public:
+    static constexpr int XDND_VERSION = 5;
+
+    XdndProxy(::Window target, const std::shared_ptr<DropFileBatches>& batches): target_(target), batches_(batches)
+    {
+        display_ = XOpenDisplay(get_display_spec().c_str());
+        if (!display_)
+            return;
+
+        xdnd_aware_ = XInternAtom(display_, "XdndAware", False);
+        xdnd_proxy_ = XInternAtom(display_, "XdndProxy", False);
+        xdnd_enter_ = XInternAtom(display_, "XdndEnter", False);
+        xdnd_position_ = XInternAtom(display_, "XdndPosition", False);
+        xdnd_status_ = XInternAtom(display_, "XdndStatus", False);
+        xdnd_leave_ = XInternAtom(display_, "XdndLeave", False);
+        xdnd_drop_ = XInternAtom(display_, "XdndDrop", False);
+        xdnd_finished_ = XInternAtom(display_, "XdndFinished", False);
+        xdnd_selection_ = XInternAtom(display_, "XdndSelection", False);
+        xdnd_type_list_ = XInternAtom(display_, "XdndTypeList", False);
+        xdnd_action_copy_ = XInternAtom(display_, "XdndActionCopy", False);
+        uri_list_ = XInternAtom(display_, "text/uri-list", False);
+        incr_ = XInternAtom(display_, "INCR", False);
+        property_ = XInternAtom(display_, "PANDA3D_IMGUI_XDND", False);
+
+        XSetWindowAttributes attrs;
+        attrs.event_mask = PropertyChangeMask;
+        proxy_ = XCreateWindow(display_, DefaultRootWindow(display_), 0, 0, 1, 1, 0, CopyFromParent, InputOnly, CopyFromParent, CWEventMask, &attrs);
+
+        const Atom version = XDND_VERSION;
+        for (::Window window : { target_, proxy_ })
+        {
+            XChangeProperty(display_, window, xdnd_aware_, XA_ATOM, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(&version), 1);
+            XChangeProperty(display_, window, xdnd_proxy_, XA_WINDOW, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(&proxy_), 1);
+        }
+        XFlush(display_);
+
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~XdndProxy()
+    {
+        if (!display_)
+            return;
+
+        stop_ = true;
+        thread_.join();
+
+        if (target_ != None)
+        {
+            XDeleteProperty(display_, target_, xdnd_aware_);
+            XDeleteProperty(display_, target_, xdnd_proxy_);
+        }
+        XDestroyWindow(display_, proxy_);
+        XCloseDisplay(display_);
+    }
+
+    /** Get display name in the same way as x11 pipe of Panda3D. */
+    static std::string get_display_spec()
+    {
+        static ConfigVariableString display_cfg("display", "");
+
+        std::string display_spec = display_cfg.get_value();
+        if (display_spec.empty())
+            display_spec = ExecutionEnvironment::get_environment_variable("DISPLAY");
+        if (display_spec.empty())
+            display_spec = ":0.0";
+
+        return display_spec;
+    }
+
+    /** Forget the target window which is already destroyed, so its properties are not touched. */
+    void detach_target()
+    {
+        target_ = None;
+    }
+
+private:
+    void run()
+    {
+        const int fd = ConnectionNumber(display_);
+        while (!stop_)
+        {
+            while (XPending(display_))
+            {
+                XEvent ev;
+                XNextEvent(display_, &ev);
+                switch (ev.type)
+                {
+                    case ClientMessage:
+                        on_client_message(ev.xclient);
+                        break;
+                    case SelectionNotify:
+                        on_selection_notify(ev.xselection);
+                        break;
+                    case PropertyNotify:
+                        on_property_notify(ev.xproperty);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            // wake up periodically to check the stop flag
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(fd, &fds);
+            timeval timeout = { 0, 100000 };
+            select(fd + 1, &fds, nullptr, nullptr, &timeout);
+        }
+    }
+
+    void on_client_message(const XClientMessageEvent& ev)
+    {
+        if (ev.message_type == xdnd_enter_)
+        {
+            source_ = static_cast<::Window>(ev.data.l[0]);
+            accept_ = false;
+            if (ev.data.l[1] & 1)
+            {
+                // more than three types
+                Atom type;
+                int format;
+                unsigned long count, remaining;
+                unsigned char* data = nullptr;
+                if (XGetWindowProperty(display_, source_, xdnd_type_list_, 0, LONG_MAX / 4, False, XA_ATOM,
+                    &type, &format, &count, &remaining, &data) == Success && data)
+                {
+                    const Atom* types = reinterpret_cast<const Atom*>(data);
+                    accept_ = std::find(types, types + count, uri_list_) != types + count;
+                }
+                if (data)
+                    XFree(data);
+            }
+            else
+            {
+                for (int k = 2; k < 5; ++k)
+                    accept_ = accept_ || static_cast<Atom>(ev.data.l[k]) == uri_list_;
+            }
+        }
+        else if (ev.message_type == xdnd_position_)
+        {
+            const int root_x = static_cast<int>((ev.data.l[2] >> 16) & 0xFFFF);
+            const int root_y = static_cast<int>(ev.data.l[2] & 0xFFFF);
+            int x, y;
+            ::Window child;
+            XTranslateCoordinates(display_, DefaultRootWindow(display_), target_, root_x, root_y, &x, &y, &child);
+            point_ = LVecBase2(static_cast<PN_stdfloat>(x), static_cast<PN_stdfloat>(y));
+
+            send_message(xdnd_status_, accept_ ? 1 : 0, 0, 0, accept_ ? xdnd_action_copy_ : None);
+        }
+        else if (ev.message_type == xdnd_leave_)
+        {
+            source_ = None;
+            accept_ = false;
+        }
+        else if (ev.message_type == xdnd_drop_)
+        {
+            if (accept_)
+                XConvertSelection(display_, xdnd_selection_, uri_list_, property_, proxy_, static_cast<Time>(ev.data.l[2]));
+            else
+                finish(false);
+        }
+    }
+
+    void on_selection_notify(const XSelectionEvent& ev)
+    {
+        if (ev.property == None)
+        {
+            finish(false);
+            return;
+        }
+
+        Atom type;
+        std::string data;
+        if (!read_property(type, data))
+        {
+            finish(false);
+            return;
+        }
+
+        if (type == incr_)
+        {
+            // large data is transferred in chunks after deleting the property.
+            incr_transfer_ = true;
+            uri_list_data_.clear();
+            return;
+        }
+
+        finish(true);
+        post_uri_list(data);
+    }
+
+    void on_property_notify(const XPropertyEvent& ev)
+    {
+        if (!incr_transfer_ || ev.atom != property_ || ev.state != PropertyNewValue)
+            return;
+
+        Atom type;
+        std::string data;
+        if (!read_property(type, data))
+        {
+            incr_transfer_ = false;
+            finish(false);
+            return;
+        }
+
+        // zero-length chunk means the end of data
+        if (!data.empty())
+        {
+            uri_list_data_ += data;
+            return;
+        }
+
+        incr_transfer_ = false;
+        finish(true);
+        post_uri_list(uri_list_data_);
+        uri_list_data_.clear();
+    }
+
+    /** Read and delete the property of the proxy window. */
+    bool read_property(Atom& type, std::string& data)
+    {
+        int format;
+        unsigned long count, remaining;
+        unsigned char* buffer = nullptr;
+        if (XGetWindowProperty(display_, proxy_, property_, 0, LONG_MAX / 4, True, AnyPropertyType,
+            &type, &format, &count, &remaining, &buffer) != Success)
+            return false;
+
+        if (buffer)
+        {
+            data.assign(reinterpret_cast<const char*>(buffer), count * (format / 8));
+            XFree(buffer);
+        }
+        XFlush(display_);
+
+        return true;
+    }
+
+    void finish(bool accepted)
+    {
+        send_message(xdnd_finished_, accepted ? 1 : 0, accepted ? xdnd_action_copy_ : None, 0, 0);
+        source_ = None;
+        accept_ = false;
+    }
+
+    void send_message(Atom message_type, long l1, long l2, long l3, long l4)
+    {
+        if (source_ == None)
+            return;
+
+        XEvent ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.xclient.type = ClientMessage;
+        ev.xclient.display = display_;
+        ev.xclient.window = source_;
+        ev.xclient.message_type = message_type;
+        ev.xclient.format = 32;
+        ev.xclient.data.l[0] = static_cast<long>(target_);
+        ev.xclient.data.l[1] = l1;
+        ev.xclient.data.l[2] = l2;
+        ev.xclient.data.l[3] = l3;
+        ev.xclient.data.l[4] = l4;
+        XSendEvent(display_, source_, False, NoEventMask, &ev);
+        XFlush(display_);
+    }
+
+    void post_uri_list(const std::string& uri_list)
+    {
+        std::vector<OSPath> paths;
+
+        size_t begin = 0;
+        while (begin < uri_list.size())
+        {
+            size_t end = uri_list.find('\n', begin);
+            if (end == std::string::npos)
+                end = uri_list.size();
+
+            size_t line_end = end;
+            if (line_end > begin && uri_list[line_end - 1] == '\r')
+                --line_end;
+
+            if (line_end > begin && uri_list[begin] != '#')
+            {
+                OSPath path = decode_file_uri(uri_list.substr(begin, line_end - begin));
+                if (!path.empty())
+                    paths.push_back(std::move(path));
+            }
+
+            begin = end + 1;
+        }
+
+        if (!paths.empty())
+            DropFilesTask::post(std::move(paths), point_, batches_);
+    }
+
+    /** Convert "file://host/path" to "/path". */
+    static OSPath decode_file_uri(const std::string& uri)
+    {
+        static const std::string scheme = "file://";
+        if (uri.compare(0, scheme.size(), scheme) != 0)
+            return {};
+
+        const size_t path_begin = uri.find('/', scheme.size());
+        if (path_begin == std::string::npos)
+            return {};
+
+        OSPath path;
+        path.reserve(uri.size() - path_begin);
+        for (size_t k = path_begin; k < uri.size(); ++k)
+        {
+            const int high = k + 2 < uri.size() ? hex_to_int(uri[k + 1]) : -1;
+            const int low = k + 2 < uri.size() ? hex_to_int(uri[k + 2]) : -1;
+            if (uri[k] == '%' && high >= 0 && low >= 0)
+            {
+                path.push_back(static_cast<char>(high * 16 + low));
+                k += 2;
+            }
+            else
+            {
+                path.push_back(uri[k]);
+            }
+        }
+
+        return path;
+    }
+
+    static int hex_to_int(char c)
+    {
+        if ('0' <= c && c <= '9')
+            return c - '0';
+        if ('a' <= c && c <= 'f')
+            return c - 'a' + 10;
+        if ('A' <= c && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    ::Window target_;
+    std::shared_ptr<DropFileBatches> batches_;
+
+    Display* display_ = nullptr;
+    ::Window proxy_ = None;
+    ::Window source_ = None;
+    bool accept_ = false;
+    bool incr_transfer_ = false;
+    std::string uri_list_data_;
+    LVecBase2 point_ = LVecBase2(0);
+
+    Atom xdnd_aware_;
+    Atom xdnd_proxy_;
+    Atom xdnd_enter_;
+    Atom xdnd_position_;
+    Atom xdnd_status_;
+    Atom xdnd_leave_;
+    Atom xdnd_drop_;
+    Atom xdnd_finished_;
+    Atom xdnd_selection_;
+    Atom xdnd_type_list_;
+    Atom xdnd_action_copy_;
+    Atom uri_list_;
+    Atom incr_;
+    Atom property_;
+
+    std::atomic<bool> stop_{ false };
+    std::thread thread_;
+#endif
+};
+
+// ************************************************************************************************
+
+struct Panda3DImGui::FontAtlas
+{
+    ImFontAtlas atlas;
+    PT(Texture) texture;        // texture of the atlas, which lives as long as the atlas
+};
+
+// ************************************************************************************************
+
+Panda3DImGui::ScopedContext::ScopedContext(const Panda3DImGui& p3d_imgui): previous_context_(ImGui::GetCurrentContext())
+{
+    ImGui::SetCurrentContext(p3d_imgui.get_context());
+}
+
+Panda3DImGui::ScopedContext::~ScopedContext()
+{
+    // keep the context current if there was no context (ex, single instance).
+    if (previous_context_)
+        ImGui::SetCurrentContext(previous_context_);
+}
+
+// ************************************************************************************************
+
+Panda3DImGui::Panda3DImGui(GraphicsWindow* window, NodePath parent, std::shared_ptr<FontAtlas> font_atlas):
+    window_(window), font_atlas_(font_atlas)
 {
     root_ = parent.attach_new_node("imgui-root", 1000);
 
-    context_ = ImGui::CreateContext();
+    // context does not own the atlas, so it lives until the last holder of the atlas is destroyed.
+    if (!font_atlas_)
+        font_atlas_ = std::make_shared<FontAtlas>();
+    else
+        font_texture_ = font_atlas_->texture;
+
+    context_ = ImGui::CreateContext(&font_atlas_->atlas);
+
+    ScopedContext scoped_context(*this);
 
     ImGuiIO& io = ImGui::GetIO();
 
     // Setup back-end capabilities flags
-    io.BackendFlags |= ImGuiBackendFlags_HasSetMousePos;
+    if (window_.is_valid_pointer())
+    {
+        io.BackendFlags |= ImGuiBackendFlags_HasMouseCursors;
+        io.BackendFlags |= ImGuiBackendFlags_HasSetMousePos;
+    }
+
+    mouse_cursor_filenames_.resize(ImGuiMouseCursor_COUNT);
+    last_mouse_cursor_ = ImGuiMouseCursor_COUNT;
 }
 
 Panda3DImGui::~Panda3DImGui()
@@ -125,14 +740,29 @@ Panda3DImGui::~Panda3DImGui()
                 DragAcceptFiles((HWND)handle->get_int_handle(), FALSE);
         }
     }
+#elif defined(PANDA3D_IMGUI_XDND)
+    if (xdnd_proxy_ && !(window_.is_valid_pointer() && window_->is_valid()))
+        xdnd_proxy_->detach_target();
+    xdnd_proxy_.reset();
 #endif
 
-    ImGui::DestroyContext();
+    // context is destroyed, so the previous context is restored manually.
+    ImGuiContext* previous_context = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(context_);
+
+    if (settings_writer_)
+        save_settings(true);
+
+    ImGui::DestroyContext(context_);
+    if (previous_context != context_)
+        ImGui::SetCurrentContext(previous_context);
     context_ = nullptr;
 }
 
 void Panda3DImGui::setup_style(Style style)
 {
+    ScopedContext scoped_context(*this);
+
     switch (style)
     {
     case Style::dark:
@@ -182,24 +812,36 @@ void Panda3DImGui::setup_shader(Shader* shader)
 
 void Panda3DImGui::setup_font()
 {
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
-    io.Fonts->AddFontDefault();
+
+    // shared atlas is already built by other instance
+    if (!font_atlas_->texture)
+        io.Fonts->AddFontDefault();
+
     setup_font_texture();
 }
 
 void Panda3DImGui::setup_font(const char* font_filename, float font_size)
 {
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
-    io.Fonts->AddFontFromFileTTF(font_filename, font_size);
+
+    // shared atlas is already built by other instance
+    if (!font_atlas_->texture)
+        io.Fonts->AddFontFromFileTTF(font_filename, font_size);
+
     setup_font_texture();
 }
 
 void Panda3DImGui::setup_event()
 {
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
 
     // for button holder although the variable is not used.
-    button_map_ = window_->get_keyboard_map();
+    if (window_.is_valid_pointer())
+        button_map_ = window_->get_keyboard_map();
 
     io.KeyMap[ImGuiKey_Tab] = KeyboardButton::tab().get_index();
     io.KeyMap[ImGuiKey_LeftArrow] = KeyboardButton::left().get_index();
@@ -226,18 +868,57 @@ void Panda3DImGui::setup_event()
 
 void Panda3DImGui::enable_file_drop()
 {
+    if (enable_file_drop_ || !window_.is_valid_pointer() || !window_->get_window_handle())
+        return;
+
+    // single thread keeps the order of dropped files
+    AsyncTaskManager::get_global_ptr()->make_task_chain(DROPFILES_TASK_CHAIN_NAME)->set_num_threads(1);
+    drop_file_batches_ = std::make_shared<DropFileBatches>();
+
     // register file drop
 #if defined(__WIN32__) || defined(_WIN32)
     enable_file_drop_ = true;
-    if (window_.is_valid_pointer())
-    {
-        DragAcceptFiles((HWND)window_->get_window_handle()->get_int_handle(), TRUE);
-        window_proc_ = std::make_unique<WindowProc>(*this);
-        window_->add_window_proc(window_proc_.get());
-    }
+    DragAcceptFiles((HWND)window_->get_window_handle()->get_int_handle(), TRUE);
+    window_proc_ = std::make_unique<WindowProc>(*this);
+    window_->add_window_proc(window_proc_.get());
+#elif defined(PANDA3D_IMGUI_XDND)
+    enable_file_drop_ = true;
+    xdnd_proxy_ = std::make_unique<XdndProxy>(static_cast<::Window>(window_->get_window_handle()->get_int_handle()), drop_file_batches_);
 #endif
 }
 
+void Panda3DImGui::setup_settings(const Filename& settings_filename)
+{
+    ScopedContext scoped_context(*this);
+    ImGuiIO& io = ImGui::GetIO();
+
+    // disable the synchronous saving of ImGui
+    io.IniFilename = nullptr;
+
+    std::string data;
+    if (VirtualFileSystem::get_global_ptr()->read_file(settings_filename, data, true))
+        ImGui::LoadIniSettingsFromMemory(data.c_str(), data.size());
+
+    // single thread keeps the order of writing
+    AsyncTaskManager::get_global_ptr()->make_task_chain(SETTINGS_TASK_CHAIN_NAME)->set_num_threads(1);
+
+    settings_writer_ = std::make_shared<SettingsWriter>();
+    settings_writer_->filename = settings_filename;
+}
+
+void Panda3DImGui::setup_mouse_cursor(int imgui_cursor, const Filename& cursor_filename)
+{
+    if (imgui_cursor < 0 || imgui_cursor >= ImGuiMouseCursor_COUNT)
+        return;
+
+    mouse_cursor_filenames_[imgui_cursor] = cursor_filename;
+    if (!cursor_filename.empty())
+        has_mouse_cursor_filename_ = true;
+
+    // force to request the cursor again
+    last_mouse_cursor_ = ImGuiMouseCursor_COUNT;
+}
+
 void Panda3DImGui::on_window_resized()
 {
     if (window_.is_valid_pointer())
@@ -246,6 +927,7 @@ void Panda3DImGui::on_window_resized()
 
 void Panda3DImGui::on_window_resized(const LVecBase2& size)
 {
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
     io.DisplaySize = ImVec2(size[0], size[1]);
     //io.DisplayFramebufferScale;
@@ -256,6 +938,7 @@ void Panda3DImGui::on_button_down_or_up(const ButtonHandle& button, bool down)
     if (button == ButtonHandle::none())
         return;
 
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
     if (MouseButton::is_mouse_button(button))
     {
@@ -311,20 +994,29 @@ void Panda3DImGui::on_keystroke(wchar_t keycode)
     if (keycode < 0 || keycode >= (std::numeric_limits<ImWchar>::max)())
         return;
 
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
     io.AddInputCharacter(keycode);
 }
 
 bool Panda3DImGui::new_frame_imgui()
 {
+    return new_frame_imgui(static_cast<float>(ClockObject::get_global_clock()->get_dt()));
+}
+
+bool Panda3DImGui::new_frame_imgui(float delta_time)
+{
+    deliver_dropped_files();
+
     if (root_.is_hidden())
         return false;
 
     static const int MOUSE_DEVICE_INDEX = 0;
 
+    ScopedContext scoped_context(*this);
     ImGuiIO& io = ImGui::GetIO();
 
-    io.DeltaTime = static_cast<float>(ClockObject::get_global_clock()->get_dt());
+    io.DeltaTime = delta_time;
 
     if (window_.is_valid_pointer() && window_->is_of_type(GraphicsWindow::get_class_type()))
     {
@@ -346,11 +1038,13 @@ bool Panda3DImGui::new_frame_imgui()
             io.MousePos.x = -FLT_MAX;
             io.MousePos.y = -FLT_MAX;
         }
+
+        update_mouse_cursor();
     }
 
     ImGui::NewFrame();
 
-    throw_event_directly(*EventHandler::get_global_event_handler(), NEW_FRAME_EVENT_NAME);
+    throw_event_directly(*EventHandler::get_global_event_handler(), new_frame_event_name_);
 
     return true;
 }
@@ -360,9 +1054,14 @@ bool Panda3DImGui::render_imgui()
     if (root_.is_hidden())
         return false;
 
+    ScopedContext scoped_context(*this);
     ImGui::Render();
 
     ImGuiIO& io = ImGui::GetIO();
+
+    if (settings_writer_ && io.WantSaveIniSettings)
+        save_settings(false);
+
     const float fb_width = io.DisplaySize.x * io.DisplayFramebufferScale.x;
     const float fb_height = io.DisplaySize.y * io.DisplayFramebufferScale.y;
 
@@ -373,14 +1072,23 @@ bool Panda3DImGui::render_imgui()
     for (int k = 0, k_end = npc.get_num_paths(); k < k_end; ++k)
         npc.get_path(k).detach_node();
 
+    render_stats_ = RenderStats();
+    const LVecBase2 display_size(io.DisplaySize.x, io.DisplaySize.y);
+
     for (int k = 0; k < draw_data->CmdListsCount; ++k)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[k];
 
-        if (!(k < static_cast<int>(geom_data_.size())))
+        // drop and merge commands before touching Panda3D objects
+        cull_draw_commands(cmd_list, display_size);
+        if (draw_batches_.empty())
+            continue;
+
+        // previous lists may be skipped by culling
+        while (!(k < static_cast<int>(geom_data_.size())))
         {
             geom_data_.push_back({
-                new GeomVertexData("imgui-vertex-" + std::to_string(k), vformat_, GeomEnums::UsageHint::UH_stream),
+                new GeomVertexData("imgui-vertex-" + std::to_string(geom_data_.size()), vformat_, GeomEnums::UsageHint::UH_stream),
                 {}
             });
         }
@@ -396,16 +1104,15 @@ bool Panda3DImGui::render_imgui()
             reinterpret_cast<const unsigned char*>(cmd_list->VtxBuffer.Data),
             cmd_list->VtxBuffer.Size * sizeof(decltype(cmd_list->VtxBuffer)::value_type));
 
-        auto idx_buffer_data = cmd_list->IdxBuffer.Data;
-        for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; ++cmd_i)
+        for (int batch_i = 0, batch_end = static_cast<int>(draw_batches_.size()); batch_i < batch_end; ++batch_i)
         {
-            const ImDrawCmd* draw_cmd = &cmd_list->CmdBuffer[cmd_i];
-            auto elem_count = static_cast<int>(draw_cmd->ElemCount);
+            const DrawBatch& batch = draw_batches_[batch_i];
+            auto elem_count = static_cast<int>(batch.elem_count);
 
-            if (!(cmd_i < static_cast<int>(geom_list.nodepaths.size())))
+            if (!(batch_i < static_cast<int>(geom_list.nodepaths.size())))
                 geom_list.nodepaths.push_back(create_geomnode(geom_list.vdata));
 
-            NodePath np = geom_list.nodepaths[cmd_i];
+            NodePath np = geom_list.nodepaths[batch_i];
             np.reparent_to(root_);
 
             auto gn = DCAST(GeomNode, np.node());
@@ -416,18 +1123,17 @@ bool Panda3DImGui::render_imgui()
 
             std::memcpy(
                 index_handle->get_write_pointer(),
-                reinterpret_cast<const unsigned char*>(idx_buffer_data),
+                reinterpret_cast<const unsigned char*>(cmd_list->IdxBuffer.Data + batch.idx_offset),
                 elem_count * sizeof(decltype(cmd_list->IdxBuffer)::value_type));
-            idx_buffer_data += elem_count;
 
             CPT(RenderState) state = RenderState::make(ScissorAttrib::make(
-                draw_cmd->ClipRect.x / fb_width,
-                draw_cmd->ClipRect.z / fb_width,
-                1 - draw_cmd->ClipRect.w / fb_height,
-                1 - draw_cmd->ClipRect.y / fb_height));
+                batch.clip_rect[0] / fb_width,
+                batch.clip_rect[2] / fb_width,
+                1 - batch.clip_rect[3] / fb_height,
+                1 - batch.clip_rect[1] / fb_height));
 
-            if (draw_cmd->TextureId)
-                state = state->add_attrib(TextureAttrib::make(static_cast<Texture*>(draw_cmd->TextureId)));
+            if (batch.texture)
+                state = state->add_attrib(TextureAttrib::make(batch.texture));
 
             gn->set_geom_state(0, state);
         }
@@ -440,6 +1146,13 @@ void Panda3DImGui::setup_font_texture()
 {
     ImGuiIO& io = ImGui::GetIO();
 
+    // reuse the texture of the shared atlas instead of baking and uploading it again
+    if (font_atlas_->texture)
+    {
+        font_texture_ = font_atlas_->texture;
+        return;
+    }
+
     unsigned char* pixels;
     int width, height;
     io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);
@@ -453,9 +1166,157 @@ void Panda3DImGui::setup_font_texture()
     PTA_uchar ram_image = font_texture_->make_ram_image();
     std::memcpy(ram_image.p(), pixels, width * height * sizeof(decltype(*pixels)));
 
+    // the atlas keeps the texture, so instances sharing it can use the texture after this is destroyed.
+    font_atlas_->texture = font_texture_;
     io.Fonts->TexID = font_texture_.p();
 }
 
+void Panda3DImGui::cull_draw_commands(const ImDrawList* cmd_list, const LVecBase2& display_size)
+{
+    draw_batches_.clear();
+
+    unsigned int idx_offset = 0;
+    for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; ++cmd_i)
+    {
+        const ImDrawCmd& draw_cmd = cmd_list->CmdBuffer[cmd_i];
+        const unsigned int cmd_idx_offset = idx_offset;
+        idx_offset += draw_cmd.ElemCount;
+
+        ++render_stats_.command_count;
+
+        if (draw_cmd.ElemCount == 0)
+        {
+            ++render_stats_.empty_culled_count;
+            continue;
+        }
+
+        // commands outside of display (ex, windows scrolled offscreen) are dropped.
+        const LVecBase4 clip_rect(
+            (std::max)(static_cast<PN_stdfloat>(draw_cmd.ClipRect.x), PN_stdfloat(0)),
+            (std::max)(static_cast<PN_stdfloat>(draw_cmd.ClipRect.y), PN_stdfloat(0)),
+            (std::min)(static_cast<PN_stdfloat>(draw_cmd.ClipRect.z), display_size[0]),
+            (std::min)(static_cast<PN_stdfloat>(draw_cmd.ClipRect.w), display_size[1]));
+        if (clip_rect[2] <= clip_rect[0] || clip_rect[3] <= clip_rect[1])
+        {
+            ++render_stats_.clipped_culled_count;
+            continue;
+        }
+
+        Texture* texture = static_cast<Texture*>(draw_cmd.TextureId);
+
+        // adjacent commands with the same state are drawn at once
+        if (!draw_batches_.empty())
+        {
+            DrawBatch& last = draw_batches_.back();
+            if (last.texture == texture && last.clip_rect == clip_rect && last.idx_offset + last.elem_count == cmd_idx_offset)
+            {
+                last.elem_count += draw_cmd.ElemCount;
+                ++render_stats_.merged_count;
+                continue;
+            }
+        }
+
+        draw_batches_.push_back({ clip_rect, texture, cmd_idx_offset, draw_cmd.ElemCount });
+    }
+
+    render_stats_.draw_count += static_cast<int>(draw_batches_.size());
+}
+
+void Panda3DImGui::deliver_dropped_files()
+{
+    if (!drop_file_batches_)
+        return;
+
+    // deliver one batch per frame, so many files do not block a frame.
+    {
+        LightMutexHolder holder(drop_file_batches_->lock);
+        if (drop_file_batches_->batches.empty())
+            return;
+
+        auto& batch = drop_file_batches_->batches.front();
+        dropped_files_ = std::move(batch.files);
+        dropped_point_ = batch.point;
+        drop_file_batches_->batches.pop_front();
+    }
+
+    throw_event(DROPFILES_EVENT_NAME);
+}
+
+void Panda3DImGui::save_settings(bool wait)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    io.WantSaveIniSettings = false;
+
+    size_t data_size = 0;
+    const char* data = ImGui::SaveIniSettingsToMemory(&data_size);
+
+    if (wait)
+    {
+        uint64_t serial;
+        {
+            LightMutexHolder holder(settings_writer_->lock);
+            serial = ++settings_writer_->last_serial;
+            settings_writer_->pending_data.clear();
+            settings_writer_->pending_serial = 0;
+        }
+
+        settings_writer_->write(std::string(data, data_size), serial);
+        return;
+    }
+
+    LightMutexHolder holder(settings_writer_->lock);
+    settings_writer_->pending_data.assign(data, data_size);
+    settings_writer_->pending_serial = ++settings_writer_->last_serial;
+
+    if (!settings_writer_->task_scheduled)
+    {
+        settings_writer_->task_scheduled = true;
+
+        PT(AsyncTask) task = new SaveSettingsTask(settings_writer_);
+        task->set_task_chain(SETTINGS_TASK_CHAIN_NAME);
+        AsyncTaskManager::get_global_ptr()->add(task);
+    }
+}
+
+void Panda3DImGui::update_mouse_cursor()
+{
+    ImGuiIO& io = ImGui::GetIO();
+    if (io.ConfigFlags & ImGuiConfigFlags_NoMouseCursorChange)
+        return;
+
+    const ImGuiMouseCursor cursor = io.MouseDrawCursor ? ImGuiMouseCursor_None : ImGui::GetMouseCursor();
+
+    // request properties only when the cursor is changed
+    if (cursor == last_mouse_cursor_)
+        return;
+    last_mouse_cursor_ = cursor;
+
+    // do not override the cursor of application unless this hides the cursor or cursor files are set.
+    WindowProperties props;
+    if (cursor == ImGuiMouseCursor_None)
+    {
+        if (!mouse_cursor_hidden_)
+        {
+            props.set_cursor_hidden(true);
+            mouse_cursor_hidden_ = true;
+        }
+    }
+    else
+    {
+        if (mouse_cursor_hidden_)
+        {
+            props.set_cursor_hidden(false);
+            mouse_cursor_hidden_ = false;
+        }
+
+        if (has_mouse_cursor_filename_)
+            props.set_cursor_filename(mouse_cursor_filenames_[cursor]);
+    }
+
+    if (props.is_any_specified())
+        window_->request_properties(props);
+}
+
 NodePath Panda3DImGui::create_geomnode(const GeomVertexData* vdata)
 {
     PT(GeomTriangles) prim = new GeomTriangles(GeomEnums::UsageHint::UH_stream);
@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include <nodePath.h>
 
 class Texture;
@@ -32,6 +34,7 @@ class GraphicsWindow;
 class ButtonHandle;
 
 struct ImGuiContext;
+struct ImDrawList;
 
 class Panda3DImGui
 {
@@ -47,8 +50,42 @@ public:
         light,
     };
 
+    /** Counters of draw commands in the last render_imgui. */
+    struct RenderStats
+    {
+        int command_count = 0;              // the number of ImDrawCmd
+        int empty_culled_count = 0;         // commands without elements
+        int clipped_culled_count = 0;       // commands whose clip rect is outside of display
+        int merged_count = 0;               // commands merged into the previous command
+        int draw_count = 0;                 // nodes drawn after culling and merging
+    };
+
+    /** Font atlas and its texture which can be shared among instances. */
+    struct FontAtlas;
+
+    /** Make the context of the instance current in the scope, and restore the previous context. */
+    class ScopedContext
+    {
+    public:
+        ScopedContext(const Panda3DImGui& p3d_imgui);
+        ~ScopedContext();
+
+        ScopedContext(const ScopedContext&) = delete;
+        ScopedContext& operator=(const ScopedContext&) = delete;
+
+    private:
+        ImGuiContext* previous_context_;
+    };
+
 public:
-    Panda3DImGui(GraphicsWindow* window, NodePath parent);
+    /**
+     * @param   window      Window for mouse and cursor.
+     *                      If nullptr, mouse position should be set to ImGuiIO by user.
+     * @param   font_atlas  Font atlas shared with other instances.
+     *                      If nullptr, new atlas is created for this instance.
+     *                      Font is added only by the first setup_font on the atlas, and others reuse its texture.
+     */
+    Panda3DImGui(GraphicsWindow* window, NodePath parent, std::shared_ptr<FontAtlas> font_atlas = nullptr);
     ~Panda3DImGui();
 
     void setup_style(Style style = Style::dark);
@@ -60,18 +97,55 @@ public:
     void setup_event();
     void enable_file_drop();
 
+    /**
+     * Load ImGui settings through VirtualFileSystem and save them instead of ImGui.
+     *
+     * Changed settings are written in thread, and the last settings are written when this is destroyed.
+     */
+    void setup_settings(const Filename& settings_filename = "imgui.ini");
+
+    /**
+     * Set OS cursor file (ex, .cur or .ani in Windows) for ImGuiMouseCursor.
+     * Empty filename uses the default cursor of the window.
+     */
+    void setup_mouse_cursor(int imgui_cursor, const Filename& cursor_filename);
+
     void on_window_resized();
     void on_window_resized(const LVecBase2& size);
     void on_button_down_or_up(const ButtonHandle& button, bool down);
     void on_keystroke(wchar_t keycode);
 
     bool new_frame_imgui();
+
+    /** Start new frame with given time since the last frame (ex, for panels which are not drawn every frame). */
+    bool new_frame_imgui(float delta_time);
+
     bool render_imgui();
 
     ImGuiContext* get_context() const;
     NodePath get_root() const;
 
-    /** Get dropped files. */
+    /**
+     * Set the name of the event thrown in new_frame_imgui (default is NEW_FRAME_EVENT_NAME).
+     * Use different names to draw different GUI in each instance.
+     */
+    void set_new_frame_event_name(const std::string& event_name);
+    const std::string& get_new_frame_event_name() const;
+
+    /** Get font atlas which can be passed to other instances. */
+    const std::shared_ptr<FontAtlas>& get_font_atlas() const;
+
+    /** Get font texture. It is shared by instances using the same font atlas. */
+    Texture* get_font_texture() const;
+
+    const RenderStats& get_render_stats() const;
+
+    /**
+     * Get dropped files.
+     *
+     * Files are checked in thread and delivered in batches, so large drop throws
+     * DROPFILES_EVENT_NAME event for each batch.
+     */
     const std::vector<Filename>& get_dropped_files() const;
 
     /** Get mouse position when files are dropped. */
@@ -79,12 +153,18 @@ public:
 
 private:
     void setup_font_texture();
+    void cull_draw_commands(const ImDrawList* cmd_list, const LVecBase2& display_size);
+    void update_mouse_cursor();
+    void deliver_dropped_files();
+    void save_settings(bool wait);
     NodePath create_geomnode(const GeomVertexData* vdata);
 
     ImGuiContext* context_ = nullptr;
 
     WPT(GraphicsWindow) window_;
     NodePath root_;
+    std::string new_frame_event_name_ = NEW_FRAME_EVENT_NAME;
+    std::shared_ptr<FontAtlas> font_atlas_;
     PT(Texture) font_texture_;
     PT(ButtonMap) button_map_;
     CPT(GeomVertexFormat) vformat_;
@@ -96,8 +176,32 @@ private:
     };
     std::vector<GeomList> geom_data_;
 
+    struct DrawBatch
+    {
+        LVecBase4 clip_rect;                // clamped to display
+        Texture* texture;
+        unsigned int idx_offset;
+        unsigned int elem_count;
+    };
+    std::vector<DrawBatch> draw_batches_;   // commands of a draw list after culling and merging
+    RenderStats render_stats_;
+
+    struct SettingsWriter;
+    class SaveSettingsTask;
+    std::shared_ptr<SettingsWriter> settings_writer_;
+
+    std::vector<Filename> mouse_cursor_filenames_;
+    bool has_mouse_cursor_filename_ = false;
+    bool mouse_cursor_hidden_ = false;      // cursor is hidden by this
+    int last_mouse_cursor_;
+
+    struct DropFileBatches;
+    class DropFilesTask;
     class WindowProc;
+    class XdndProxy;
     std::unique_ptr<WindowProc> window_proc_;
+    std::unique_ptr<XdndProxy> xdnd_proxy_;
+    std::shared_ptr<DropFileBatches> drop_file_batches_;
     bool enable_file_drop_ = false;
     std::vector<Filename> dropped_files_;
     LVecBase2 dropped_point_;
@@ -115,6 +219,31 @@ inline NodePath Panda3DImGui::get_root() const
     return root_;
 }
 
+inline void Panda3DImGui::set_new_frame_event_name(const std::string& event_name)
+{
+    new_frame_event_name_ = event_name;
+}
+
+inline const std::string& Panda3DImGui::get_new_frame_event_name() const
+{
+    return new_frame_event_name_;
+}
+
+inline const std::shared_ptr<Panda3DImGui::FontAtlas>& Panda3DImGui::get_font_atlas() const
+{
+    return font_atlas_;
+}
+
+inline Texture* Panda3DImGui::get_font_texture() const
+{
+    return font_texture_;
+}
+
+inline const Panda3DImGui::RenderStats& Panda3DImGui::get_render_stats() const
+{
+    return render_stats_;
+}
+
 inline const std::vector<Filename>& Panda3DImGui::get_dropped_files() const
 {
     return dropped_files_;
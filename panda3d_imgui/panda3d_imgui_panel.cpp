@@ -0,0 +1,253 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018-2019 Younguk Kim (bluekyu)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "panda3d_imgui_panel.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <imgui.h>
+
+#include <camera.h>
+#include <cardMaker.h>
+#include <clockObject.h>
+#include <displayRegion.h>
+#include <finiteBoundingVolume.h>
+#include <graphicsEngine.h>
+#include <graphicsOutput.h>
+#include <orthographicLens.h>
+#include <transparencyAttrib.h>
+
+Panda3DImGuiPanel::Panda3DImGuiPanel(const std::string& name, GraphicsOutput* host, int width, int height,
+    std::shared_ptr<Panda3DImGui::FontAtlas> font_atlas): width_(width), height_(height)
+{
+    // pixel2d of the panel whose origin is the upper-left corner
+    scene_ = NodePath("imgui-panel-scene-" + name);
+    NodePath pixel2d = scene_.attach_new_node("imgui-panel-pixel2d");
+    pixel2d.set_pos(-1, 0, 1);
+    pixel2d.set_scale(2.0f / width_, 1, 2.0f / height_);
+
+    // panel context does not become current even if there is no other context.
+    ImGuiContext* previous_context = ImGui::GetCurrentContext();
+    imgui_ = std::make_unique<Panda3DImGui>(nullptr, pixel2d, font_atlas);
+    {
+        // panel does not share imgui.ini of the main instance. Use setup_settings for own settings file.
+        Panda3DImGui::ScopedContext scoped_context(*imgui_);
+        ImGui::GetIO().IniFilename = nullptr;
+    }
+    imgui_->setup_geom();
+    imgui_->on_window_resized(LVecBase2(static_cast<PN_stdfloat>(width_), static_cast<PN_stdfloat>(height_)));
+    imgui_->set_new_frame_event_name(std::string(Panda3DImGui::NEW_FRAME_EVENT_NAME) + "-" + name);
+    ImGui::SetCurrentContext(previous_context);
+
+    texture_ = new Texture("imgui-panel-" + name);
+    texture_->set_minfilter(SamplerState::FilterType::FT_linear);
+    texture_->set_magfilter(SamplerState::FilterType::FT_linear);
+
+    const PN_stdfloat half_width = static_cast<PN_stdfloat>(width_) / height_ / 2;
+    CardMaker cm("imgui-panel-card-" + name);
+    cm.set_frame(-half_width, half_width, -0.5f, 0.5f);
+    card_ = NodePath(cm.generate());
+    card_.set_texture(texture_);
+    card_.set_transparency(TransparencyAttrib::M_alpha);
+    card_.set_two_sided(true);
+    display_node_ = card_;
+
+    buffer_ = host->make_texture_buffer("imgui-panel-" + name, width_, height_, texture_, false);
+    if (!buffer_)
+        return;
+
+    // render before the host, and only when the panel is redrawn
+    buffer_->set_sort(host->get_sort() - 1);
+    buffer_->set_clear_color_active(true);
+    buffer_->set_clear_color(LColor(0, 0, 0, 0));
+    buffer_->set_one_shot(true);
+
+    PT(OrthographicLens) lens = new OrthographicLens();
+    lens->set_film_size(2, 2);
+    lens->set_near_far(-1000, 1000);
+
+    NodePath camera = scene_.attach_new_node(new Camera("imgui-panel-camera-" + name, lens));
+    buffer_->make_display_region()->set_camera(camera);
+}
+
+Panda3DImGuiPanel::~Panda3DImGuiPanel()
+{
+    imgui_.reset();
+
+    if (buffer_)
+        buffer_->get_engine()->remove_window(buffer_);
+
+    card_.remove_node();
+}
+
+bool Panda3DImGuiPanel::pick(const NodePath& camera, const LPoint2& film_point)
+{
+    LPoint3 near_point;
+    LPoint3 far_point;
+    if (!DCAST(Camera, camera.node())->get_lens()->extrude(film_point, near_point, far_point))
+    {
+        clear_pick();
+        return false;
+    }
+
+    // intersect the ray with XZ plane of the card
+    const LPoint3 from = card_.get_relative_point(camera, near_point);
+    const LVector3 direction = card_.get_relative_point(camera, far_point) - from;
+    if (IS_NEARLY_ZERO(direction[1]))
+    {
+        clear_pick();
+        return false;
+    }
+
+    const PN_stdfloat t = -from[1] / direction[1];
+    const LPoint3 hit = from + direction * t;
+    const PN_stdfloat half_width = static_cast<PN_stdfloat>(width_) / height_ / 2;
+    if (t < 0 || std::abs(hit[0]) > half_width || std::abs(hit[2]) > 0.5f)
+    {
+        clear_pick();
+        return false;
+    }
+
+    pick(LTexCoord((hit[0] + half_width) / (2 * half_width), hit[2] + 0.5f));
+
+    return true;
+}
+
+void Panda3DImGuiPanel::pick(const LTexCoord& uv)
+{
+    Panda3DImGui::ScopedContext scoped_context(*imgui_);
+    ImGuiIO& io = ImGui::GetIO();
+    io.MousePos.x = uv[0] * width_;
+    io.MousePos.y = (1 - uv[1]) * height_;
+
+    hovered_ = true;
+}
+
+void Panda3DImGuiPanel::clear_pick()
+{
+    if (!hovered_)
+        return;
+
+    Panda3DImGui::ScopedContext scoped_context(*imgui_);
+    ImGuiIO& io = ImGui::GetIO();
+    io.MousePos.x = -FLT_MAX;
+    io.MousePos.y = -FLT_MAX;
+
+    // redraw once to clear hovered state
+    hovered_ = false;
+    redraw_requested_ = true;
+}
+
+bool Panda3DImGuiPanel::update(const NodePath& camera)
+{
+    if (!buffer_)
+        return false;
+
+    const double now = ClockObject::get_global_clock()->get_frame_time();
+
+    if (!redraw_requested_ && last_update_time_ >= 0)
+    {
+        float rate = max_update_rate_;
+        if (!hovered_)
+        {
+            // invisible panel is not redrawn
+            const float screen_size = compute_screen_size(camera);
+            if (screen_size <= 0)
+                return false;
+
+            rate = min_update_rate_ + (max_update_rate_ - min_update_rate_) * screen_size;
+        }
+
+        if (rate <= 0 || now - last_update_time_ < 1.0 / rate)
+            return false;
+    }
+
+    const float delta_time = last_update_time_ < 0 ?
+        static_cast<float>(ClockObject::get_global_clock()->get_dt()) :
+        static_cast<float>(now - last_update_time_);
+
+    if (!imgui_->new_frame_imgui((std::max)(delta_time, 1e-4f)))
+        return false;
+    imgui_->render_imgui();
+
+    buffer_->set_one_shot(true);
+
+    last_update_time_ = now;
+    redraw_requested_ = false;
+
+    return true;
+}
+
+float Panda3DImGuiPanel::compute_screen_size(const NodePath& camera) const
+{
+    Camera* cam = DCAST(Camera, camera.node());
+
+    // node which is hidden or not in the scene of camera is invisible
+    if (display_node_.is_empty() || !display_node_.has_parent() || display_node_.is_hidden(cam->get_camera_mask()) ||
+        display_node_.is_stashed() || display_node_.get_top() != camera.get_top())
+        return 0;
+
+    PT(BoundingVolume) bounds = display_node_.get_bounds();
+    if (bounds->is_empty() || !bounds->is_of_type(FiniteBoundingVolume::get_class_type()))
+        return 0;
+
+    const FiniteBoundingVolume* finite_bounds = DCAST(FiniteBoundingVolume, bounds);
+    const LPoint3 bounds_min = finite_bounds->get_min();
+    const LPoint3 bounds_max = finite_bounds->get_max();
+
+    const LMatrix4 mat = display_node_.get_transform(camera)->get_mat() * cam->get_lens()->get_projection_mat();
+
+    LPoint2 min_point(FLT_MAX);
+    LPoint2 max_point(-FLT_MAX);
+    bool in_front = false;
+    for (int k = 0; k < 8; ++k)
+    {
+        const LPoint3 corner(
+            (k & 1) ? bounds_max[0] : bounds_min[0],
+            (k & 2) ? bounds_max[1] : bounds_min[1],
+            (k & 4) ? bounds_max[2] : bounds_min[2]);
+
+        const LVecBase4 p = mat.xform(LVecBase4(corner, 1));
+        if (p[3] <= 0)
+            continue;
+
+        const LPoint2 ndc(p[0] / p[3], p[1] / p[3]);
+        min_point = min_point.fmin(ndc);
+        max_point = max_point.fmax(ndc);
+        in_front = true;
+    }
+
+    if (!in_front)
+        return 0;
+
+    // fraction of the screen covered by bounds of the node
+    min_point = min_point.fmax(LPoint2(-1));
+    max_point = max_point.fmin(LPoint2(1));
+    if (min_point[0] >= max_point[0] || min_point[1] >= max_point[1])
+        return 0;
+
+    return static_cast<float>((std::max)(max_point[0] - min_point[0], max_point[1] - min_point[1]) / 2);
+}
@@ -0,0 +1,157 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018-2019 Younguk Kim (bluekyu)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <nodePath.h>
+
+#include "panda3d_imgui.hpp"
+
+class GraphicsOutput;
+class Texture;
+
+/**
+ * ImGui panel rendered to offscreen texture for world space.
+ *
+ * The texture is mapped on the card of get_card() or user geometry, and mouse is
+ * ray-picked into panel coordinates. To reduce cost of many panels, each panel is
+ * redrawn with the rate by its size on screen.
+ */
+class Panda3DImGuiPanel
+{
+public:
+    /**
+     * @param   name        Name of the panel. GUI is drawn in "imgui-new-frame-{name}" event.
+     * @param   host        Graphics output to create offscreen buffer.
+     * @param   font_atlas  Font atlas shared with other instances.
+     */
+    Panda3DImGuiPanel(const std::string& name, GraphicsOutput* host, int width, int height,
+        std::shared_ptr<Panda3DImGui::FontAtlas> font_atlas = nullptr);
+    ~Panda3DImGuiPanel();
+
+    Panda3DImGuiPanel(const Panda3DImGuiPanel&) = delete;
+    Panda3DImGuiPanel& operator=(const Panda3DImGuiPanel&) = delete;
+
+    /** Get ImGui helper of this panel to setup style, shader, font, and input. */
+    Panda3DImGui& get_imgui() const;
+
+    /** Get texture of the panel to map on user geometry. */
+    Texture* get_texture() const;
+
+    /** Get card textured with the panel. The height is 1 and it is centered on XZ plane. */
+    NodePath get_card() const;
+
+    /**
+     * Set node which displays the panel texture (default is the card).
+     * Its bounds on screen decide the redraw rate, and it is not redrawn if the node is hidden or detached.
+     */
+    void set_display_node(const NodePath& display_node);
+    NodePath get_display_node() const;
+
+    /**
+     * Pick the card with ray from camera through film point (-1 to 1).
+     * @return  true if the card is hit.
+     */
+    bool pick(const NodePath& camera, const LPoint2& film_point);
+
+    /** Set mouse position from texture coordinates of hit point on user geometry. */
+    void pick(const LTexCoord& uv);
+
+    /** Clear mouse position when nothing is picked. */
+    void clear_pick();
+
+    /**
+     * Set redraw rate (Hz) range.
+     * The rate is interpolated by size of the display node on screen, and hovered panel uses the maximum.
+     */
+    void set_update_rate(float min_rate, float max_rate);
+
+    /** Redraw in the next update. */
+    void request_redraw();
+
+    /**
+     * Draw ImGui and render the texture if it is time to redraw.
+     * @return  true if redrawn.
+     */
+    bool update(const NodePath& camera);
+
+private:
+    float compute_screen_size(const NodePath& camera) const;
+
+    int width_;
+    int height_;
+
+    PT(GraphicsOutput) buffer_;
+    PT(Texture) texture_;
+    NodePath scene_;
+    NodePath card_;
+    NodePath display_node_;
+    std::unique_ptr<Panda3DImGui> imgui_;
+
+    float min_update_rate_ = 1.0f;
+    float max_update_rate_ = 60.0f;
+    double last_update_time_ = -1.0;
+    bool redraw_requested_ = true;
+    bool hovered_ = false;
+};
+
+// ************************************************************************************************
+
+inline Panda3DImGui& Panda3DImGuiPanel::get_imgui() const
+{
+    return *imgui_;
+}
+
+inline Texture* Panda3DImGuiPanel::get_texture() const
+{
+    return texture_;
+}
+
+inline NodePath Panda3DImGuiPanel::get_card() const
+{
+    return card_;
+}
+
+inline void Panda3DImGuiPanel::set_display_node(const NodePath& display_node)
+{
+    display_node_ = display_node;
+}
+
+inline NodePath Panda3DImGuiPanel::get_display_node() const
+{
+    return display_node_;
+}
+
+inline void Panda3DImGuiPanel::set_update_rate(float min_rate, float max_rate)
+{
+    min_update_rate_ = min_rate;
+    max_update_rate_ = max_rate;
+}
+
+inline void Panda3DImGuiPanel::request_redraw()
+{
+    redraw_requested_ = true;
+}
@@ -0,0 +1,233 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018-2019 Younguk Kim (bluekyu)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "panda3d_imgui_texture_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <asyncTaskManager.h>
+#include <asyncTaskChain.h>
+#include <clockObject.h>
+#include <config_putil.h>
+#include <virtualFileSystem.h>
+#include <lightMutex.h>
+#include <lightMutexHolder.h>
+#include <pnmImage.h>
+#include <pnmImageHeader.h>
+
+struct Panda3DImGuiTextureCache::LoadResults
+{
+    LightMutex lock;
+    std::vector<std::pair<std::string, PT(Texture)>> textures;     // nullptr if loading is failed
+};
+
+class Panda3DImGuiTextureCache::LoadTask : public AsyncTask
+{
+public:
+    LoadTask(const Filename& filename, int thumbnail_size, const std::shared_ptr<LoadResults>& results):
+        AsyncTask("imgui-texture-cache-load"), filename_(filename), thumbnail_size_(thumbnail_size), results_(results)
+    {
+    }
+
+protected:
+    DoneStatus do_task() override
+    {
+        PT(Texture) texture = load_thumbnail();
+
+        LightMutexHolder holder(results_->lock);
+        results_->textures.emplace_back(filename_.get_fullpath(), texture);
+
+        return DS_done;
+    }
+
+private:
+    PT(Texture) load_thumbnail() const
+    {
+        // relative filename is resolved on model-path in this thread
+        Filename filename(filename_);
+        VirtualFileSystem::get_global_ptr()->resolve_filename(filename, get_model_path().get_value());
+
+        PNMImageHeader header;
+        if (!header.read_header(filename))
+            return nullptr;
+
+        const int x_size = header.get_x_size();
+        const int y_size = header.get_y_size();
+        if (x_size <= 0 || y_size <= 0)
+            return nullptr;
+
+        const float scale = (std::min)(1.0f, static_cast<float>(thumbnail_size_) / (std::max)(x_size, y_size));
+        const int thumb_x_size = (std::max)(1, static_cast<int>(x_size * scale));
+        const int thumb_y_size = (std::max)(1, static_cast<int>(y_size * scale));
+
+        // some readers (ex, JPEG) can decode directly in the reduced size.
+        PNMImage image;
+        image.set_read_size(thumb_x_size, thumb_y_size);
+        if (!image.read(filename))
+            return nullptr;
+
+        if (image.get_x_size() != thumb_x_size || image.get_y_size() != thumb_y_size)
+        {
+            PNMImage thumbnail(thumb_x_size, thumb_y_size, image.get_num_channels(), image.get_maxval(), image.get_type());
+            thumbnail.quick_filter_from(image);
+            image.take_from(thumbnail);
+        }
+
+        PT(Texture) texture = new Texture(filename_.get_basename());
+        if (!texture->load(image))
+            return nullptr;
+
+        texture->set_minfilter(SamplerState::FilterType::FT_linear);
+        texture->set_magfilter(SamplerState::FilterType::FT_linear);
+        texture->set_keep_ram_image(false);
+
+        return texture;
+    }
+
+    Filename filename_;
+    int thumbnail_size_;
+    std::shared_ptr<LoadResults> results_;
+};
+
+// ************************************************************************************************
+
+Panda3DImGuiTextureCache::Panda3DImGuiTextureCache(int thumbnail_size, size_t memory_budget, int num_threads):
+    thumbnail_size_(thumbnail_size), memory_budget_(memory_budget), load_results_(std::make_shared<LoadResults>())
+{
+    task_chain_ = AsyncTaskManager::get_global_ptr()->make_task_chain(TASK_CHAIN_NAME);
+    task_chain_->set_num_threads((std::max)(1, num_threads));
+    task_chain_->set_thread_priority(ThreadPriority::TP_low);
+
+    placeholder_ = Texture::make_texture();
+    placeholder_->set_name("imgui-texture-cache-placeholder");
+    placeholder_->setup_2d_texture(1, 1, Texture::ComponentType::T_unsigned_byte, Texture::Format::F_rgba);
+
+    PTA_uchar ram_image = placeholder_->make_ram_image();
+    std::memset(ram_image.p(), 128, ram_image.size());
+}
+
+Panda3DImGuiTextureCache::~Panda3DImGuiTextureCache()
+{
+    clear();
+}
+
+Texture* Panda3DImGuiTextureCache::get_texture(const Filename& filename)
+{
+    const std::string& key = filename.get_fullpath();
+
+    auto found = entries_.find(key);
+    if (found != entries_.end())
+    {
+        auto& entry = found->second;
+        entry.last_used_frame = ClockObject::get_global_clock()->get_frame_count();
+        lru_list_.splice(lru_list_.begin(), lru_list_, entry.lru_iter);
+        return entry.texture ? entry.texture.p() : placeholder_.p();
+    }
+
+    lru_list_.push_front(key);
+
+    auto& entry = entries_[key];
+    entry.lru_iter = lru_list_.begin();
+    entry.task = new LoadTask(filename, thumbnail_size_, load_results_);
+    entry.task->set_task_chain(TASK_CHAIN_NAME);
+    AsyncTaskManager::get_global_ptr()->add(entry.task);
+    entry.last_used_frame = ClockObject::get_global_clock()->get_frame_count();
+    entry.memory_size = compute_memory_size(key, entry);
+    memory_usage_ += entry.memory_size;
+
+    return placeholder_;
+}
+
+void Panda3DImGuiTextureCache::update()
+{
+    decltype(load_results_->textures) textures;
+    {
+        LightMutexHolder holder(load_results_->lock);
+        textures.swap(load_results_->textures);
+    }
+
+    for (auto& result : textures)
+    {
+        auto found = entries_.find(result.first);
+
+        // evicted or already loaded by the previous request
+        if (found == entries_.end() || !found->second.task)
+            continue;
+
+        auto& entry = found->second;
+        entry.task.clear();
+        entry.texture = result.second;
+
+        memory_usage_ -= entry.memory_size;
+        entry.memory_size = compute_memory_size(found->first, entry);
+        memory_usage_ += entry.memory_size;
+    }
+
+    evict();
+}
+
+void Panda3DImGuiTextureCache::clear()
+{
+    while (!entries_.empty())
+        remove_entry(entries_.begin());
+
+    LightMutexHolder holder(load_results_->lock);
+    load_results_->textures.clear();
+}
+
+void Panda3DImGuiTextureCache::evict()
+{
+    // thumbnails used in the current or previous frame are visible, so they are kept over the budget.
+    const int frame_count = ClockObject::get_global_clock()->get_frame_count();
+    while (memory_usage_ > memory_budget_ && !lru_list_.empty())
+    {
+        auto iter = entries_.find(lru_list_.back());
+        if (iter->second.last_used_frame >= frame_count - 1)
+            break;
+        remove_entry(iter);
+    }
+}
+
+size_t Panda3DImGuiTextureCache::compute_memory_size(const std::string& key, const Entry& entry) const
+{
+    // failed and loading entries are also counted, so the number of entries is bounded by the budget.
+    size_t memory_size = sizeof(Entry) + key.size();
+    if (entry.texture)
+        memory_size += entry.texture->get_expected_ram_image_size();
+    else if (entry.task)
+        memory_size += static_cast<size_t>(thumbnail_size_) * thumbnail_size_ * 4;     // estimated RGBA thumbnail
+    return memory_size;
+}
+
+void Panda3DImGuiTextureCache::remove_entry(std::unordered_map<std::string, Entry>::iterator iter)
+{
+    auto& entry = iter->second;
+    if (entry.task)
+        entry.task->remove();
+
+    memory_usage_ -= entry.memory_size;
+    lru_list_.erase(entry.lru_iter);
+    entries_.erase(iter);
+}
@@ -0,0 +1,140 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018-2019 Younguk Kim (bluekyu)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <filename.h>
+#include <texture.h>
+#include <asyncTask.h>
+
+class AsyncTaskChain;
+
+/**
+ * Cache of thumbnail textures for ImGui::Image.
+ *
+ * Images are loaded and downscaled in threads of AsyncTaskManager,
+ * and placeholder texture is returned until the loading is done.
+ * Old thumbnails are evicted by LRU when the memory exceeds the budget.
+ */
+class Panda3DImGuiTextureCache
+{
+public:
+    static constexpr const char* TASK_CHAIN_NAME = "imgui-texture-cache";
+
+public:
+    /**
+     * @param   thumbnail_size  Maximum width and height of thumbnails.
+     * @param   memory_budget   Maximum bytes of cached thumbnails.
+     * @param   num_threads     The number of threads for loading.
+     */
+    Panda3DImGuiTextureCache(int thumbnail_size = 128, size_t memory_budget = 64 * 1024 * 1024, int num_threads = 2);
+    ~Panda3DImGuiTextureCache();
+
+    Panda3DImGuiTextureCache(const Panda3DImGuiTextureCache&) = delete;
+    Panda3DImGuiTextureCache& operator=(const Panda3DImGuiTextureCache&) = delete;
+
+    /**
+     * Get thumbnail of the image. Relative filename is resolved on model-path.
+     * If the image is not loaded yet, this starts loading and returns placeholder.
+     */
+    Texture* get_texture(const Filename& filename);
+
+    /**
+     * Collect loaded thumbnails and evict old thumbnails. Call this once per frame before drawing.
+     * Thumbnails used in the current or previous frame are not evicted even if the budget is exceeded.
+     */
+    void update();
+
+    /** Remove all thumbnails and cancel loading. */
+    void clear();
+
+    void set_placeholder(Texture* placeholder);
+    Texture* get_placeholder() const;
+
+    void set_memory_budget(size_t memory_budget);
+    size_t get_memory_budget() const;
+
+    /** Get bytes of cached thumbnails. */
+    size_t get_memory_usage() const;
+
+private:
+    class LoadTask;
+    struct LoadResults;
+
+    struct Entry
+    {
+        PT(Texture) texture;                // nullptr if loading or failed
+        PT(AsyncTask) task;                 // nullptr if loading is done
+        size_t memory_size = 0;
+        int last_used_frame = 0;
+        std::list<std::string>::iterator lru_iter;
+    };
+
+    void evict();
+    size_t compute_memory_size(const std::string& key, const Entry& entry) const;
+    void remove_entry(std::unordered_map<std::string, Entry>::iterator iter);
+
+    int thumbnail_size_;
+    size_t memory_budget_;
+    size_t memory_usage_ = 0;
+
+    PT(Texture) placeholder_;
+    PT(AsyncTaskChain) task_chain_;
+    std::shared_ptr<LoadResults> load_results_;
+
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<std::string> lru_list_;       // front is the most recently used
+};
+
+// ************************************************************************************************
+
+inline void Panda3DImGuiTextureCache::set_placeholder(Texture* placeholder)
+{
+    placeholder_ = placeholder;
+}
+
+inline Texture* Panda3DImGuiTextureCache::get_placeholder() const
+{
+    return placeholder_;
+}
+
+inline void Panda3DImGuiTextureCache::set_memory_budget(size_t memory_budget)
+{
+    memory_budget_ = memory_budget;
+}
+
+inline size_t Panda3DImGuiTextureCache::get_memory_budget() const
+{
+    return memory_budget_;
+}
+
+inline size_t Panda3DImGuiTextureCache::get_memory_usage() const
+{
+    return memory_usage_;
+}
@@ -175,6 +175,10 @@ int main()
     panda3d_imgui_helper.setup_event();
     panda3d_imgui_helper.on_window_resized();
     panda3d_imgui_helper.enable_file_drop();
+    panda3d_imgui_helper.setup_settings();
+
+    // use OS cursor files for ImGui cursor shapes.
+    //panda3d_imgui_helper.setup_mouse_cursor(ImGuiMouseCursor_TextInput, Filename("cursor/text_input.cur"));
 
     // setup Panda3D task and key event
     setup_render(&panda3d_imgui_helper);